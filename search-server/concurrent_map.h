@@ -1,53 +1,270 @@
-#include <cstdlib>
-#include <map>
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <mutex>
-#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-#include "log_duration.h"
-#include "test_framework.h"
-
-using namespace std::string_literals;
+inline constexpr size_t CACHE_LINE_SIZE = 64;
 
-template <typename Key, typename Value>
+// Hash map split into shards, each an open-addressing table guarded by its own mutex.
+// Shards are cache-line aligned so that threads working on neighbouring shards do not false-share
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
 class ConcurrentMap {
-private:
-    struct Paired {
-        std::map<Key, Value> data;
-        std::mutex mutex;
-    };
 public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
-
     struct Access {
         std::lock_guard<std::mutex> guard;
         Value& ref_to_value;
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : pairs_(bucket_count) {}
+    explicit ConcurrentMap(size_t shard_count) : shards_(std::max<size_t>(shard_count, 1)) {}
 
     Access operator[](const Key& key) {
-        auto index = static_cast<uint64_t>(key) % pairs_.size();
-        auto& pair = pairs_[index];
-        return {std::lock_guard(pair.mutex), pair.data[key]};
-    }
-    
-    auto Erase(const Key& key) {
-        auto index = static_cast<uint64_t>(key) % pairs_.size();
-        auto& pair = pairs_[index];
-        std::lock_guard guard(pair.mutex);
-        return pair.data.erase(key);
-    }
-    
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
-        for (auto& [data, lock] : pairs_) {
-            std::lock_guard g(lock);
-            result.insert(data.begin(), data.end());
+        const size_t hash = Hash{}(key);
+        Shard& shard = shards_[hash % shards_.size()];
+        return { std::lock_guard(shard.mutex), FindOrInsert(shard, key, hash / shards_.size()).entry.second };
+    }
+
+    size_t Erase(const Key& key) {
+        const size_t hash = Hash{}(key);
+        Shard& shard = shards_[hash % shards_.size()];
+        std::lock_guard guard(shard.mutex);
+        Slot* slot = Find(shard, key, hash / shards_.size());
+        if (slot == nullptr) {
+            return 0;
+        }
+        slot->state = SlotState::ERASED;
+        // Releases whatever the value owns now rather than at the next rehash
+        slot->entry = {};
+        --shard.size;
+        return 1;
+    }
+
+    // Moves all entries out in no particular order and leaves the map empty
+    std::vector<std::pair<Key, Value>> ExtractUnordered() {
+        std::vector<std::pair<Key, Value>> result;
+        for (Shard& shard : shards_) {
+            std::lock_guard guard(shard.mutex);
+            for (Slot& slot : shard.slots) {
+                if (slot.state == SlotState::FULL) {
+                    result.push_back(std::move(slot.entry));
+                }
+            }
+            shard.slots.clear();
+            shard.size = 0;
+            shard.used = 0;
         }
         return result;
     }
 
 private:
-    std::vector<Paired> pairs_;
+    enum class SlotState : uint8_t {
+        EMPTY,
+        FULL,
+        ERASED,
+    };
+
+    struct Slot {
+        SlotState state = SlotState::EMPTY;
+        // Hash within the shard, kept to skip key comparisons and rehash without hashing again
+        size_t hash = 0;
+        std::pair<Key, Value> entry;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::mutex mutex;
+        // Size is a power of two
+        std::vector<Slot> slots;
+        // Full slots, and full plus erased ones which still lengthen probe sequences
+        size_t size = 0;
+        size_t used = 0;
+    };
+
+    std::vector<Shard> shards_;
+
+    static Slot* Find(Shard& shard, const Key& key, size_t hash) {
+        if (shard.slots.empty()) {
+            return nullptr;
+        }
+        const size_t mask = shard.slots.size() - 1;
+        for (size_t index = hash & mask; shard.slots[index].state != SlotState::EMPTY; index = (index + 1) & mask) {
+            Slot& slot = shard.slots[index];
+            if (slot.state == SlotState::FULL && slot.hash == hash && slot.entry.first == key) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    static Slot& FindOrInsert(Shard& shard, const Key& key, size_t hash) {
+        if (Slot* slot = Find(shard, key, hash)) {
+            return *slot;
+        }
+        if (2 * (shard.used + 1) > shard.slots.size()) {
+            Rehash(shard);
+        }
+        const size_t mask = shard.slots.size() - 1;
+        size_t index = hash & mask;
+        while (shard.slots[index].state == SlotState::FULL) {
+            index = (index + 1) & mask;
+        }
+        Slot& slot = shard.slots[index];
+        if (slot.state == SlotState::EMPTY) {
+            ++shard.used;
+        }
+        slot.state = SlotState::FULL;
+        slot.hash = hash;
+        slot.entry = { key, Value() };
+        ++shard.size;
+        return slot;
+    }
+
+    static void Rehash(Shard& shard) {
+        size_t slot_count = 8;
+        while (slot_count < 4 * (shard.size + 1)) {
+            slot_count <<= 1;
+        }
+        std::vector<Slot> old_slots(slot_count);
+        std::swap(old_slots, shard.slots);
+        shard.used = shard.size;
+        const size_t mask = slot_count - 1;
+        for (Slot& old_slot : old_slots) {
+            if (old_slot.state != SlotState::FULL) {
+                continue;
+            }
+            size_t index = old_slot.hash & mask;
+            while (shard.slots[index].state == SlotState::FULL) {
+                index = (index + 1) & mask;
+            }
+            shard.slots[index] = std::move(old_slot);
+        }
+    }
+};
+
+// Lock-free per-key sums for integral keys and arithmetic values. The table never grows:
+// capacity given to the constructor must cover every distinct key that will be added
+template <typename Key, typename Value>
+class ConcurrentAccumulator {
+public:
+    static_assert(std::is_integral_v<Key>, "ConcurrentAccumulator supports only integer keys");
+    static_assert(std::is_arithmetic_v<Value>, "ConcurrentAccumulator supports only arithmetic values");
+
+    explicit ConcurrentAccumulator(size_t capacity)
+        : slots_(SlotCount(capacity))
+        , mask_(slots_.size() - 1)
+        , shift_(64 - Log2(slots_.size())) {
+    }
+
+    void Add(Key key, Value delta) {
+        Slot& slot = FindOrInsert(key);
+        if constexpr (std::is_integral_v<Value>) {
+            slot.value.fetch_add(delta, std::memory_order_relaxed);
+        }
+        else {
+            Value current = slot.value.load(std::memory_order_relaxed);
+            while (!slot.value.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    bool Erase(Key key) {
+        for (size_t index = Index(key), probes = 0; probes < slots_.size(); index = (index + 1) & mask_, ++probes) {
+            Slot& slot = slots_[index];
+            uint8_t state = WaitPublished(slot);
+            if (state == EMPTY) {
+                return false;
+            }
+            if (state == FULL && slot.key == key) {
+                return slot.state.compare_exchange_strong(state, ERASED, std::memory_order_acq_rel);
+            }
+        }
+        return false;
+    }
+
+    // Scans the whole table, so it is meant for diagnostics rather than the search path
+    size_t GetEntryCount() const {
+        return std::count_if(slots_.begin(), slots_.end(), [](const Slot& slot) {
+            return slot.state.load(std::memory_order_acquire) == FULL;
+        });
+    }
+
+    std::vector<std::pair<Key, Value>> BuildUnorderedVector() const {
+        std::vector<std::pair<Key, Value>> result;
+        for (const Slot& slot : slots_) {
+            if (slot.state.load(std::memory_order_acquire) == FULL) {
+                result.emplace_back(slot.key, slot.value.load(std::memory_order_relaxed));
+            }
+        }
+        return result;
+    }
+
+private:
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint8_t BUSY = 1;
+    static constexpr uint8_t FULL = 2;
+    static constexpr uint8_t ERASED = 3;
+
+    struct Slot {
+        std::atomic<uint8_t> state{ EMPTY };
+        Key key{};
+        std::atomic<Value> value{};
+    };
+
+    std::vector<Slot> slots_;
+    const size_t mask_;
+    const size_t shift_;
+
+    static size_t Log2(size_t power_of_two) {
+        size_t result = 0;
+        while ((size_t(1) << result) < power_of_two) {
+            ++result;
+        }
+        return result;
+    }
+
+    // Fibonacci hashing spreads keys that share low bits, e.g. ids which are multiples of a power of two
+    size_t Index(Key key) const {
+        return (static_cast<uint64_t>(key) * 11400714819323198485ull) >> shift_;
+    }
+
+    static size_t SlotCount(size_t capacity) {
+        size_t slot_count = 8;
+        while (slot_count < 2 * capacity) {
+            slot_count <<= 1;
+        }
+        return slot_count;
+    }
+
+    // Waits until a slot claimed by another thread gets its key
+    static uint8_t WaitPublished(const Slot& slot) {
+        uint8_t state = slot.state.load(std::memory_order_acquire);
+        while (state == BUSY) {
+            state = slot.state.load(std::memory_order_acquire);
+        }
+        return state;
+    }
+
+    Slot& FindOrInsert(Key key) {
+        for (size_t index = Index(key), probes = 0; probes < slots_.size(); index = (index + 1) & mask_, ++probes) {
+            Slot& slot = slots_[index];
+            uint8_t state = WaitPublished(slot);
+            if (state == EMPTY) {
+                if (slot.state.compare_exchange_strong(state, BUSY, std::memory_order_acquire)) {
+                    slot.key = key;
+                    slot.state.store(FULL, std::memory_order_release);
+                    return slot;
+                }
+                state = WaitPublished(slot);
+            }
+            if (state == FULL && slot.key == key) {
+                return slot;
+            }
+        }
+        throw std::length_error("ConcurrentAccumulator capacity exceeded");
+    }
 };
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "corpus_reader.h"
+
+using namespace std;
+
+static const size_t CORPUS_CHUNK_SIZE = 16 << 20;
+
+struct CorpusRecord {
+    bool is_valid = false;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+    string_view text;
+};
+
+static bool ParseNumber(string_view field, int& value) {
+    const auto [ptr, error] = from_chars(field.data(), field.data() + field.size(), value);
+    return error == errc() && ptr == field.data() + field.size();
+}
+
+static bool ParseStatus(string_view field, DocumentStatus& status) {
+    if (field == "ACTUAL"sv) {
+        status = DocumentStatus::ACTUAL;
+    }
+    else if (field == "IRRELEVANT"sv) {
+        status = DocumentStatus::IRRELEVANT;
+    }
+    else if (field == "BANNED"sv) {
+        status = DocumentStatus::BANNED;
+    }
+    else if (field == "REMOVED"sv) {
+        status = DocumentStatus::REMOVED;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Cuts the field ending with a tab off the front of the line, returns false if there is no tab
+static bool NextField(string_view& line, string_view& field) {
+    const size_t tab = line.find('\t');
+    if (tab == string_view::npos) {
+        return false;
+    }
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+// Runs inside a parallel algorithm, so errors are reported through is_valid instead of exceptions
+static CorpusRecord ParseRecord(string_view line) {
+    CorpusRecord record;
+    string_view id_field, status_field, ratings_field;
+    if (!NextField(line, id_field) || !NextField(line, status_field) || !NextField(line, ratings_field)) {
+        return record;
+    }
+    if (!ParseNumber(id_field, record.document_id) || !ParseStatus(status_field, record.status)) {
+        return record;
+    }
+    for (const string_view rating : SplitIntoWords(ratings_field)) {
+        record.ratings.push_back(0);
+        if (!ParseNumber(rating, record.ratings.back())) {
+            return record;
+        }
+    }
+    record.text = line;
+    record.is_valid = true;
+    return record;
+}
+
+static void IngestLines(SearchServer& search_server, string_view text, size_t& line_number, IngestStats& stats) {
+    vector<string_view> lines;
+    while (!text.empty()) {
+        const size_t end = min(text.find('\n'), text.size());
+        string_view line = text.substr(0, end);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        lines.push_back(line);
+        text.remove_prefix(min(text.size(), end + 1));
+    }
+    
+    vector<CorpusRecord> records(lines.size());
+    transform(execution::par,
+              lines.begin(), lines.end(),
+              records.begin(),
+              [](const string_view line) {
+                  return line.empty() ? CorpusRecord{} : ParseRecord(line);
+              });
+    
+    for (size_t i = 0; i < records.size(); ++i) {
+        ++line_number;
+        if (lines[i].empty()) {
+            continue;
+        }
+        const CorpusRecord& record = records[i];
+        if (!record.is_valid) {
+            throw invalid_argument("Corpus line "s + to_string(line_number) + " is malformed"s);
+        }
+        try {
+            search_server.AddDocument(record.document_id, record.text, record.status, record.ratings);
+        }
+        catch (const invalid_argument& error) {
+            throw invalid_argument("Corpus line "s + to_string(line_number) + ": "s + error.what());
+        }
+        ++stats.documents;
+    }
+}
+
+IngestStats LoadCorpus(SearchServer& search_server, istream& input) {
+    const auto start_time = chrono::steady_clock::now();
+    IngestStats stats;
+    size_t line_number = 0;
+    
+    // Holds one chunk plus the incomplete line carried over from the previous one
+    string buffer;
+    while (input) {
+        const size_t carried = buffer.size();
+        buffer.resize(carried + CORPUS_CHUNK_SIZE);
+        input.read(buffer.data() + carried, CORPUS_CHUNK_SIZE);
+        // A read error ends the loop just like EOF does, so it is told apart here
+        if (input.bad()) {
+            throw runtime_error("Cannot read corpus after "s + to_string(stats.bytes) + " bytes"s);
+        }
+        buffer.resize(carried + input.gcount());
+        stats.bytes += input.gcount();
+        
+        const size_t complete = input ? buffer.rfind('\n') + 1 : buffer.size();
+        IngestLines(search_server, string_view(buffer.data(), complete), line_number, stats);
+        buffer.erase(0, complete);
+    }
+    
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+    return stats;
+}
+
+IngestStats LoadCorpus(SearchServer& search_server, const string& path) {
+    ifstream input(path, ios::binary);
+    if (!input) {
+        throw invalid_argument("Cannot open corpus file "s + path);
+    }
+    return LoadCorpus(search_server, input);
+}
+
+double IngestStats::DocumentsPerSecond() const {
+    return seconds > 0.0 ? documents / seconds : 0.0;
+}
+
+double IngestStats::MegabytesPerSecond() const {
+    return seconds > 0.0 ? bytes / seconds / (1 << 20) : 0.0;
+}
+
+ostream& operator<<(ostream& out, const IngestStats& stats) {
+    out << stats.documents << " documents, "s << stats.bytes << " bytes in "s << stats.seconds << " s ("s
+        << stats.DocumentsPerSecond() << " docs/s, "s << stats.MegabytesPerSecond() << " MB/s)"s;
+    return out;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "search_server.h"
+
+// Corpus line format: <id>\t<ACTUAL|IRRELEVANT|BANNED|REMOVED>\t<space separated ratings>\t<text>
+struct IngestStats {
+    size_t documents = 0;
+    size_t bytes = 0;
+    double seconds = 0.0;
+
+    double DocumentsPerSecond() const;
+    double MegabytesPerSecond() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const IngestStats& stats);
+
+// Reads the corpus in large chunks, parses the lines of every chunk in parallel
+// and adds documents straight from the chunk buffer
+IngestStats LoadCorpus(SearchServer& search_server, std::istream& input);
+IngestStats LoadCorpus(SearchServer& search_server, const std::string& path);
@@ -0,0 +1,24 @@
+#include "memory_stats.h"
+
+using namespace std;
+
+size_t MemoryStats::TotalBytes() const {
+    return word_to_document_freqs.bytes + id_to_word_freqs.bytes + documents.bytes
+        + document_ids.bytes + tombstones.bytes + stop_words.bytes + dictionary.bytes;
+}
+
+static void PrintStructure(ostream& out, const string& name, const StructureMemory& memory) {
+    out << name << ": "s << memory.bytes << " bytes, "s << memory.objects << " objects"s << endl;
+}
+
+ostream& operator<<(ostream& out, const MemoryStats& stats) {
+    PrintStructure(out, "word_to_document_freqs"s, stats.word_to_document_freqs);
+    PrintStructure(out, "id_to_word_freqs"s, stats.id_to_word_freqs);
+    PrintStructure(out, "documents"s, stats.documents);
+    PrintStructure(out, "document_ids"s, stats.document_ids);
+    PrintStructure(out, "tombstones"s, stats.tombstones);
+    PrintStructure(out, "stop_words"s, stats.stop_words);
+    PrintStructure(out, "dictionary"s, stats.dictionary);
+    out << "total: "s << stats.TotalBytes() << " bytes"s;
+    return out;
+}
\ No newline at end of file
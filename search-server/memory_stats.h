@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+struct StructureMemory {
+    size_t bytes = 0;
+    size_t objects = 0;
+};
+
+struct MemoryStats {
+    StructureMemory word_to_document_freqs;
+    StructureMemory id_to_word_freqs;
+    StructureMemory documents;
+    StructureMemory document_ids;
+    StructureMemory tombstones;
+    StructureMemory stop_words;
+    StructureMemory dictionary;
+
+    size_t TotalBytes() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const MemoryStats& stats);
+
+// Heap bytes of one std::map/std::set node: color plus parent/left/right links and the value
+template <typename Value>
+constexpr size_t TreeNodeBytes() {
+    return 4 * sizeof(void*) + sizeof(Value);
+}
+
+// Heap bytes of one std::unordered_map/std::unordered_set node: next link and the value
+template <typename Value>
+constexpr size_t HashNodeBytes() {
+    return sizeof(void*) + sizeof(Value);
+}
+
+// Heap bytes owned by a string beyond its own object (zero while it fits the small buffer)
+inline size_t StringHeapBytes(const std::string& str) {
+    static const size_t small_capacity = std::string().capacity();
+    return str.capacity() > small_capacity ? str.capacity() + 1 : 0;
+}
\ No newline at end of file
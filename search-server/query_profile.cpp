@@ -0,0 +1,55 @@
+#include "query_profile.h"
+
+using namespace std;
+
+QueryProfiler::QueryProfiler(QueryProfile& profile)
+    : profile_(profile)
+    , counters_(profile.terms.size()) {
+}
+
+void QueryProfiler::OnTerm(size_t term_index, size_t posting_count, double inverse_document_freq) {
+    profile_.terms[term_index].posting_count = posting_count;
+    profile_.terms[term_index].inverse_document_freq = inverse_document_freq;
+}
+
+void QueryProfiler::OnPosting(size_t term_index, bool is_accepted) {
+    counters_[term_index].scanned.fetch_add(1, memory_order_relaxed);
+    if (is_accepted) {
+        counters_[term_index].accepted.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void QueryProfiler::OnAccumulator(size_t capacity) {
+    profile_.accumulator_capacity = capacity;
+}
+
+void QueryProfiler::Finish() {
+    profile_.minus_eliminations = 0;
+    for (size_t i = 0; i < counters_.size(); ++i) {
+        TermProfile& term = profile_.terms[i];
+        term.postings_scanned = counters_[i].scanned.load(memory_order_relaxed);
+        term.postings_accepted = counters_[i].accepted.load(memory_order_relaxed);
+        if (term.is_minus) {
+            profile_.minus_eliminations += term.postings_accepted;
+        }
+    }
+}
+
+ostream& operator<<(ostream& out, const QueryProfile& profile) {
+    using namespace std::chrono;
+    out << "parse: "s << duration_cast<microseconds>(profile.parse_time).count() << " us, "s
+        << "scoring: "s << duration_cast<microseconds>(profile.scoring_time).count() << " us, "s
+        << "sort: "s << duration_cast<microseconds>(profile.sort_time).count() << " us"s << endl;
+    for (const TermProfile& term : profile.terms) {
+        out << (term.is_minus ? "-"s : " "s) << term.word
+            << ": postings = "s << term.posting_count
+            << ", idf = "s << term.inverse_document_freq
+            << ", scanned = "s << term.postings_scanned
+            << ", accepted = "s << term.postings_accepted << endl;
+    }
+    out << "accumulator capacity: "s << profile.accumulator_capacity
+        << ", entries: "s << profile.accumulator_entries
+        << ", minus eliminations: "s << profile.minus_eliminations
+        << ", matched documents: "s << profile.matched_documents;
+    return out;
+}
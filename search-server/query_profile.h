@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct TermProfile {
+    std::string word;
+    bool is_minus = false;
+    size_t posting_count = 0;
+    // Prefix terms: sum over their expansions
+    double inverse_document_freq = 0.0;
+    size_t postings_scanned = 0;
+    // Plus words: postings accepted by the predicate. Minus words: documents eliminated
+    size_t postings_accepted = 0;
+};
+
+struct QueryProfile {
+    std::chrono::nanoseconds parse_time{};
+    std::chrono::nanoseconds scoring_time{};
+    std::chrono::nanoseconds sort_time{};
+    std::vector<TermProfile> terms;
+    size_t accumulator_capacity = 0;
+    // Documents holding relevance after the plus terms, before minus words eliminate any
+    size_t accumulator_entries = 0;
+    size_t minus_eliminations = 0;
+    size_t matched_documents = 0;
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryProfile& profile);
+
+// Profiler of the searches nobody profiles, its calls compile to nothing
+class NoQueryProfiler {
+public:
+    void OnTerm(size_t, size_t, double) {
+    }
+
+    void OnPosting(size_t, bool) {
+    }
+
+    void OnAccumulator(size_t) {
+    }
+
+    template <typename Accumulator>
+    void OnPlusTermsScored(const Accumulator&) {
+    }
+};
+
+// Collects counters into profile.terms, which must already list the plus words, minus words,
+// plus prefixes and minus prefixes in that order.
+// Postings may be reported from several threads at once
+class QueryProfiler {
+public:
+    explicit QueryProfiler(QueryProfile& profile);
+
+    void OnTerm(size_t term_index, size_t posting_count, double inverse_document_freq);
+    void OnPosting(size_t term_index, bool is_accepted);
+    void OnAccumulator(size_t capacity);
+
+    template <typename Accumulator>
+    void OnPlusTermsScored(const Accumulator& accumulator) {
+        profile_.accumulator_entries = accumulator.GetEntryCount();
+    }
+
+    // Copies the counters into the profile
+    void Finish();
+
+private:
+    struct TermCounters {
+        std::atomic<size_t> scanned{ 0 };
+        std::atomic<size_t> accepted{ 0 };
+    };
+
+    QueryProfile& profile_;
+    std::vector<TermCounters> counters_;
+};
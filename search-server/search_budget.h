@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "document.h"
+
+struct SearchBudget {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point deadline = Clock::time_point::max();
+    // Set to true by another thread to stop the search
+    const std::atomic<bool>* cancelled = nullptr;
+};
+
+struct SearchResult {
+    std::vector<Document> documents;
+    // The budget ran out, documents are the best of the postings scanned so far
+    bool is_partial = false;
+};
+
+// Budget of the searches without a deadline, checks of it compile to nothing
+class UnlimitedBudget {
+public:
+    bool IsExhausted() const {
+        return false;
+    }
+
+    bool WasExhausted() const {
+        return false;
+    }
+};
+
+// Checked between posting blocks, possibly from several threads at once
+class BudgetTracker {
+public:
+    explicit BudgetTracker(const SearchBudget& budget) : budget_(budget) {}
+
+    bool IsExhausted() {
+        if (exhausted_.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if ((budget_.cancelled != nullptr && budget_.cancelled->load(std::memory_order_relaxed))
+            || SearchBudget::Clock::now() >= budget_.deadline) {
+            exhausted_.store(true, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    bool WasExhausted() const {
+        return exhausted_.load(std::memory_order_relaxed);
+    }
+
+private:
+    const SearchBudget& budget_;
+    std::atomic<bool> exhausted_{ false };
+};
\ No newline at end of file
@@ -5,31 +5,131 @@
 #include <map>
 #include <set>
 #include <execution>
+#include <chrono>
 
 #include "search_server.h"
 
 using namespace std;
 
-SearchServer::SearchServer(const string& stop_words_text) :
-    SearchServer(SplitIntoWords(stop_words_text)) {}
+SearchServer::SearchServer(const string& stop_words_text, IndexOptions options) :
+    SearchServer(SplitIntoWords(stop_words_text), options) {}
 
-SearchServer::SearchServer(const string_view stop_words_text) :
-    SearchServer(SplitIntoWords(stop_words_text)) {}
+SearchServer::SearchServer(const string_view stop_words_text, IndexOptions options) :
+    SearchServer(SplitIntoWords(stop_words_text), options) {}
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
     const vector<int>& ratings) {
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
+    if (IsRemoved(document_id)) {
+        CompactIndex();
+    }
     
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, string(document) });
-    const auto words = SplitIntoWordsNoStop(documents_.at(document_id).word);
+    const auto words = SplitIntoWordsNoStop(document);
+    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
     const double inv_word_count = 1.0 / words.size();
-    for (const string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        id_to_word_freqs_[document_id][word] += inv_word_count;
+    map<string_view, double> word_freqs;
+    for (const string_view raw_word : words) {
+        auto it = dictionary_.find(raw_word);
+        if (it == dictionary_.end()) {
+            it = dictionary_.emplace(raw_word).first;
+        }
+        word_freqs[*it] += inv_word_count;
+    }
+    for (const auto [word, freq] : word_freqs) {
+        PostingList& postings = word_to_document_freqs_[word];
+        if (!postings.empty() && postings.back().document_id > document_id) {
+            unsorted_postings_.insert(&postings);
+            has_unsorted_postings_.store(true, memory_order_release);
+        }
+        postings.push_back({ document_id, static_cast<TermFrequency>(freq) });
     }
     document_ids_.insert(document_id);
+    
+    const map<string_view, double>* indexed_word_freqs = &word_freqs;
+    if (options_.keep_forward_index) {
+        indexed_word_freqs = &id_to_word_freqs_.emplace(document_id, move(word_freqs)).first->second;
+    }
+    // Runs once the document is fully indexed, so the handler may query the server about it
+    if (standing_query_handler_) {
+        MatchStandingQueries(document_id, *indexed_word_freqs);
+    }
+}
+
+int SearchServer::AddStandingQuery(const string_view raw_query, DocumentStatus status) {
+    // Validates the query before it is stored
+    const Query query = ParseQuery(raw_query, false);
+    if (!query.plus_prefixes.empty() || !query.minus_prefixes.empty()) {
+        throw invalid_argument("Standing queries do not support prefix terms"s);
+    }
+    
+    const int query_id = next_standing_query_id_++;
+    StandingQuery& standing_query = standing_queries_[query_id];
+    standing_query.text = string(raw_query);
+    standing_query.query = ParseQuery(standing_query.text, true);
+    standing_query.status = status;
+    for (const string_view word : standing_query.query.plus_words) {
+        auto it = word_to_standing_queries_.find(word);
+        if (it == word_to_standing_queries_.end()) {
+            it = word_to_standing_queries_.emplace(string(word), set<int>{}).first;
+        }
+        it->second.insert(query_id);
+    }
+    return query_id;
+}
+
+void SearchServer::RemoveStandingQuery(int query_id) {
+    const auto query_it = standing_queries_.find(query_id);
+    if (query_it == standing_queries_.end()) {
+        return;
+    }
+    for (const string_view word : query_it->second.query.plus_words) {
+        const auto it = word_to_standing_queries_.find(word);
+        it->second.erase(query_id);
+        if (it->second.empty()) {
+            word_to_standing_queries_.erase(it);
+        }
+    }
+    standing_queries_.erase(query_it);
+}
+
+void SearchServer::SetStandingQueryHandler(StandingQueryHandler handler) {
+    standing_query_handler_ = move(handler);
+}
+
+void SearchServer::MatchStandingQueries(int document_id, const map<string_view, double>& word_freqs) const {
+    // Only the queries sharing a plus word with the document can match it
+    set<int> candidates;
+    for (const auto& [word, freq] : word_freqs) {
+        const auto it = word_to_standing_queries_.find(word);
+        if (it != word_to_standing_queries_.end()) {
+            candidates.insert(it->second.begin(), it->second.end());
+        }
+    }
+    
+    const DocumentData& document_data = documents_.at(document_id);
+    for (const int query_id : candidates) {
+        const StandingQuery& standing_query = standing_queries_.at(query_id);
+        if (standing_query.status != document_data.status) {
+            continue;
+        }
+        const bool has_minus_words = any_of(standing_query.query.minus_words.begin(), standing_query.query.minus_words.end(),
+            [&word_freqs](const string_view word) {
+                return word_freqs.count(word) > 0;
+            });
+        if (has_minus_words) {
+            continue;
+        }
+        double relevance = 0.0;
+        for (const string_view word : standing_query.query.plus_words) {
+            const auto it = word_freqs.find(word);
+            if (it != word_freqs.end()) {
+                relevance += it->second * ComputeWordInverseDocumentFreq(it->first);
+            }
+        }
+        standing_query_handler_(query_id, { document_id, relevance, document_data.rating });
+    }
 }
 
 
@@ -63,6 +163,22 @@ vector<Document> SearchServer::FindTopDocuments(const execution::parallel_policy
     return FindTopDocuments(execution::par, raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(const string_view raw_query, QueryProfile& profile) const {
+    return FindTopDocuments(execution::seq,
+        raw_query, [](int, DocumentStatus document_status, int) {
+            return document_status == DocumentStatus::ACTUAL;
+        },
+        profile);
+}
+
+SearchResult SearchServer::FindTopDocuments(const string_view raw_query, const SearchBudget& budget) const {
+    return FindTopDocuments(execution::seq,
+        raw_query, [](int, DocumentStatus document_status, int) {
+            return document_status == DocumentStatus::ACTUAL;
+        },
+        budget);
+}
+
 
 set<int>::const_iterator SearchServer::begin() const {
     return document_ids_.begin();
@@ -87,22 +203,76 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
             using namespace std::string_literals;
             throw std::out_of_range("out of range"s);
     }
+    return MatchQuery(ParseQuery(raw_query, true), document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query,
+        int document_id, QueryProfile& profile) const {
+    using Clock = chrono::steady_clock;
+    if (!document_ids_.count(document_id)){
+            throw std::out_of_range("out of range"s);
+    }
+    profile = {};
+    
+    auto start_time = Clock::now();
     const Query query = ParseQuery(raw_query, true);
+    profile.parse_time = Clock::now() - start_time;
     
+    start_time = Clock::now();
+    auto result = MatchQuery(query, document_id);
+    profile.scoring_time = Clock::now() - start_time;
+    
+    AddProfileTerms(query, profile);
+    const size_t word_count = query.plus_words.size() + query.minus_words.size();
+    for (size_t i = 0; i < query.plus_prefix_words.size(); ++i) {
+        TermProfile& term = profile.terms[word_count + i];
+        for (const string_view word : query.plus_prefix_words[i]) {
+            term.posting_count += GetPostingCount(word);
+            term.inverse_document_freq += ComputeWordInverseDocumentFreq(word);
+            term.postings_accepted |= HasPosting(word, document_id) ? 1 : 0;
+        }
+    }
+    for (size_t i = 0; i < query.minus_prefixes.size(); ++i) {
+        TermProfile& term = profile.terms[word_count + query.plus_prefixes.size() + i];
+        ForEachPrefixWord(query.minus_prefixes[i], [&term](const string_view, const PostingList& postings) {
+            term.posting_count += postings.size();
+        });
+        term.postings_accepted = HasPrefixPosting(query.minus_prefixes[i], document_id) ? 1 : 0;
+        profile.minus_eliminations += term.postings_accepted;
+    }
+    for (size_t i = 0; i < word_count; ++i) {
+        TermProfile& term = profile.terms[i];
+        term.posting_count = GetPostingCount(term.word);
+        if (!term.is_minus && term.posting_count > 0) {
+            term.inverse_document_freq = ComputeWordInverseDocumentFreq(term.word);
+        }
+        term.postings_accepted = HasPosting(term.word, document_id) ? 1 : 0;
+        if (term.is_minus) {
+            profile.minus_eliminations += term.postings_accepted;
+        }
+    }
+    profile.matched_documents = get<0>(result).empty() ? 0 : 1;
+    return result;
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchQuery(const Query& query, int document_id) const {
+    SortPendingPostings();
     const auto check_word = [this, document_id](string_view word) {
-                               const auto it = word_to_document_freqs_.find(word);
-                               return it->second.count(document_id) && it != word_to_document_freqs_.end();};
+                               return HasPosting(word, document_id);};
     
     bool has_stop_words = any_of(execution::seq, query.minus_words.begin(), query.minus_words.end(),
-                           check_word);
+                           check_word)
+        || any_of(execution::seq, query.minus_prefixes.begin(), query.minus_prefixes.end(),
+                  [this, document_id](string_view prefix) { return HasPrefixPosting(prefix, document_id); });
     
     if (has_stop_words) {
-        return { {}, documents_.at(document_id).status};
+        return { vector<string_view>{}, documents_.at(document_id).status};
     }
     
-    vector<string_view> matched_words(query.plus_words.size());
+    const vector<string_view> plus_words = CollectPlusWords(query);
+    vector<string_view> matched_words(plus_words.size());
     auto last_copy = copy_if(execution::seq,
-        query.plus_words.begin(), query.plus_words.end(),
+        plus_words.begin(), plus_words.end(),
         matched_words.begin(),
         check_word
     );
@@ -112,6 +282,60 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
     return { matched_words, documents_.at(document_id).status };
 }
 
+vector<string_view> SearchServer::IntersectWords(const vector<string_view>& words,
+    const map<string_view, double>& word_freqs) {
+    vector<string_view> result;
+    auto it = word_freqs.begin();
+    for (const string_view word : words) {
+        while (it != word_freqs.end() && it->first < word) {
+            ++it;
+        }
+        if (it == word_freqs.end()) {
+            break;
+        }
+        if (it->first == word) {
+            result.push_back(word);
+        }
+    }
+    return result;
+}
+
+bool SearchServer::HasWordWithPrefix(const map<string_view, double>& word_freqs, const string_view prefix) {
+    // Words starting with the prefix are the first ones not less than it
+    const auto it = word_freqs.lower_bound(prefix);
+    return it != word_freqs.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const string_view raw_query,
+    const vector<int>& document_ids) const {
+    return MatchQueryBatch(execution::seq, raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const execution::sequenced_policy&,
+    const string_view raw_query, const vector<int>& document_ids) const {
+    return MatchQueryBatch(execution::seq, raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(const execution::parallel_policy&,
+    const string_view raw_query, const vector<int>& document_ids) const {
+    return MatchQueryBatch(execution::par, raw_query, document_ids);
+}
+
+void SearchServer::AddProfileTerms(const Query& query, QueryProfile& profile) {
+    for (const string_view word : query.plus_words) {
+        profile.terms.push_back({ string(word), false });
+    }
+    for (const string_view word : query.minus_words) {
+        profile.terms.push_back({ string(word), true });
+    }
+    for (const string_view prefix : query.plus_prefixes) {
+        profile.terms.push_back({ string(prefix) + "*"s, false });
+    }
+    for (const string_view prefix : query.minus_prefixes) {
+        profile.terms.push_back({ string(prefix) + "*"s, true });
+    }
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const string_view raw_query,
         int document_id) const {
     if (!document_ids_.count(document_id)){
@@ -120,21 +344,24 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
     }
     
     const Query query = ParseQuery(raw_query, false);
+    SortPendingPostings();
     
     const auto check_word = [this, document_id](string_view word) {
-                               const auto it = word_to_document_freqs_.find(word);
-                               return it->second.count(document_id) && it != word_to_document_freqs_.end();};
+                               return HasPosting(word, document_id);};
     
     bool has_stop_words = any_of(execution::par, query.minus_words.begin(), query.minus_words.end(),
-                           check_word);
+                           check_word)
+        || any_of(execution::par, query.minus_prefixes.begin(), query.minus_prefixes.end(),
+                  [this, document_id](string_view prefix) { return HasPrefixPosting(prefix, document_id); });
     
     if (has_stop_words) {
-        return { {}, documents_.at(document_id).status};
+        return { vector<string_view>{}, documents_.at(document_id).status};
     }
     
-    vector<string_view> matched_words(query.plus_words.size());
+    const vector<string_view> plus_words = CollectPlusWords(query);
+    vector<string_view> matched_words(plus_words.size());
     auto last_copy = copy_if(execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
+        plus_words.begin(), plus_words.end(),
         matched_words.begin(),
         check_word
     );
@@ -145,7 +372,7 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
 }
 
 bool SearchServer::IsStopWord(const string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_word_filter_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(const string_view word) {
@@ -185,18 +412,31 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
         is_minus = true;
         word.remove_prefix(1);
     }
+    bool is_prefix = false;
+    if (!word.empty() && word.back() == '*') {
+        is_prefix = true;
+        word.remove_suffix(1);
+    }
     if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
         throw invalid_argument("Query word "s + string(text) + " is invalid");
     }
 
-    return { word, is_minus, IsStopWord(word) };
+    return { word, is_minus, !is_prefix && IsStopWord(word), is_prefix };
 }
 
 SearchServer::Query SearchServer::ParseQuery(const string_view text, const bool to_sort) const {
     Query result;
     for (const string_view word : SplitIntoWords(text)) {
         const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
+        if (query_word.is_prefix) {
+            if (query_word.is_minus) {
+                result.minus_prefixes.push_back(query_word.data);
+            }
+            else {
+                result.plus_prefixes.push_back(query_word.data);
+            }
+        }
+        else if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 result.minus_words.push_back(query_word.data);
             }
@@ -205,6 +445,7 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text, const bool
             }
         }
     }
+    ExpandPrefixes(result);
     if (to_sort) {
         sort(result.plus_words.begin(), result.plus_words.end());
         sort(result.minus_words.begin(), result.minus_words.end());
@@ -216,8 +457,52 @@ SearchServer::Query SearchServer::ParseQuery(const string_view text, const bool
     return result;
 }
 
+vector<string_view> SearchServer::FindWordsByPrefix(const string_view prefix) const {
+    vector<string_view> words;
+    for (auto it = dictionary_.lower_bound(prefix); it != dictionary_.end() && words.size() < MAX_PREFIX_EXPANSIONS; ++it) {
+        if (it->compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        words.push_back(*it);
+    }
+    return words;
+}
+
+void SearchServer::ExpandPrefixes(Query& query) const {
+    sort(query.plus_prefixes.begin(), query.plus_prefixes.end());
+    query.plus_prefixes.erase(unique(query.plus_prefixes.begin(), query.plus_prefixes.end()), query.plus_prefixes.end());
+    
+    // Overlapping prefixes such as ca* and cat* are deduplicated by word rather than by prefix,
+    // since a truncated expansion of the shorter one may miss words of the longer one
+    set<string_view> expanded_words(query.plus_words.begin(), query.plus_words.end());
+    for (const string_view prefix : query.plus_prefixes) {
+        auto words = FindWordsByPrefix(prefix);
+        words.erase(remove_if(words.begin(), words.end(),
+                              [&expanded_words](const string_view word) {
+                                  return !expanded_words.insert(word).second;
+                              }),
+                    words.end());
+        query.plus_prefix_words.push_back(move(words));
+    }
+}
+
+vector<string_view> SearchServer::CollectPlusWords(const Query& query) {
+    if (query.plus_prefix_words.empty()) {
+        return query.plus_words;
+    }
+    vector<string_view> words = query.plus_words;
+    for (const auto& prefix_words : query.plus_prefix_words) {
+        words.insert(words.end(), prefix_words.begin(), prefix_words.end());
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
 double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+    // Removed documents count until compaction so that the ratio matches the posting list sizes
+    const size_t indexed_document_count = documents_.size() + pending_removals_.size();
+    return log(indexed_document_count * 1.0 / word_to_document_freqs_.at(word).size());
 }
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
@@ -225,45 +510,173 @@ const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id
     if (document_ids_.find(document_id) == document_ids_.end()) {
         return empty;
     }
+    if (!options_.keep_forward_index) {
+        // Rebuilt from the inverted index, valid until the next call from the same thread
+        thread_local map<string_view, double> word_freqs;
+        word_freqs = BuildWordFrequencies(document_id);
+        return word_freqs;
+    }
     return id_to_word_freqs_.at(document_id);
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-    for (auto [word, freq] : GetWordFrequencies(document_id)) {
-        auto it = word_to_document_freqs_[word].find(document_id);
-        if (it != word_to_document_freqs_[word].end()) {
-            word_to_document_freqs_[word].erase(it);
+map<string_view, double> SearchServer::BuildWordFrequencies(int document_id) const {
+    map<string_view, double> word_freqs;
+    if (document_ids_.find(document_id) == document_ids_.end()) {
+        return word_freqs;
+    }
+    if (options_.keep_forward_index) {
+        return id_to_word_freqs_.at(document_id);
+    }
+    SortPendingPostings();
+    for (const auto& [word, postings] : word_to_document_freqs_) {
+        const auto it = FindPosting(postings, document_id);
+        if (it != postings.end()) {
+            word_freqs.emplace_hint(word_freqs.end(), word, it->freq);
         }
     }
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-    id_to_word_freqs_.erase(document_id);
+    return word_freqs;
 }
 
-void SearchServer::RemoveDocument(const std::execution::sequenced_policy& , int document_id) {
-    RemoveDocument(document_id);
+void SearchServer::RemoveDocument(int document_id) {
+    RemoveDocument(execution::seq, document_id);
 }
 
+void SearchServer::RemoveDocument(const std::execution::sequenced_policy& , int document_id) {
+    RemoveDocuments({ document_id });
+    CompactIndex(execution::seq);
+}
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy& , int document_id) {
-    if (id_to_word_freqs_.count(document_id) == 0) {
+    RemoveDocuments({ document_id });
+    CompactIndex(execution::par);
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        if (document_ids_.count(document_id) == 0) {
+            continue;
+        }
+        pending_removals_.insert(document_id);
+        documents_.erase(document_id);
+        document_ids_.erase(document_id);
+    }
+}
+
+void SearchServer::CompactIndex() {
+    CompactIndex(execution::seq);
+}
+
+void SearchServer::SortPendingPostings() const {
+    if (!has_unsorted_postings_.load(memory_order_acquire)) {
         return;
     }
+    lock_guard guard(unsorted_postings_mutex_);
+    if (!has_unsorted_postings_.load(memory_order_relaxed)) {
+        return;
+    }
+    const auto by_id = [](const Posting& lhs, const Posting& rhs) {
+        return lhs.document_id < rhs.document_id;
+    };
+    for (PostingList* postings : unsorted_postings_) {
+        // Only the tail after the sorted prefix needs sorting, then one merge
+        const auto sorted_end = is_sorted_until(postings->begin(), postings->end(), by_id);
+        sort(sorted_end, postings->end(), by_id);
+        inplace_merge(postings->begin(), sorted_end, postings->end(), by_id);
+    }
+    unsorted_postings_.clear();
+    has_unsorted_postings_.store(false, memory_order_release);
+}
+
+void SearchServer::ErasePostings(PostingList& postings, const vector<int>& document_ids) {
+    if (document_ids.size() <= MAX_POINT_REMOVALS) {
+        // A few binary searches instead of a pass over every posting. Going from the back shifts less
+        for (auto it = document_ids.rbegin(); it != document_ids.rend(); ++it) {
+            const auto posting = FindPosting(postings, *it);
+            if (posting != postings.end()) {
+                postings.erase(posting);
+            }
+        }
+        return;
+    }
+    // Postings and ids are both sorted, so one merge pass finds the postings to drop
+    auto id_it = document_ids.begin();
+    postings.erase(remove_if(postings.begin(), postings.end(),
+                             [&id_it, &document_ids](const Posting& posting) {
+                                 while (id_it != document_ids.end() && *id_it < posting.document_id) {
+                                     ++id_it;
+                                 }
+                                 return id_it != document_ids.end() && *id_it == posting.document_id;
+                             }),
+                   postings.end());
+}
+
+void SearchServer::EraseWordIfUnused(const string_view word) {
+    const auto it = word_to_document_freqs_.find(word);
+    if (it == word_to_document_freqs_.end() || !it->second.empty()) {
+        return;
+    }
+    const auto word_it = dictionary_.find(word);
+    word_to_document_freqs_.erase(it);
+    dictionary_.erase(word_it);
+}
+
+bool SearchServer::IsRemoved(int document_id) const {
+    return pending_removals_.count(document_id) > 0;
+}
+
+SearchServer::PostingList::const_iterator SearchServer::FindPosting(const PostingList& postings, int document_id) {
+    const auto it = lower_bound(postings.begin(), postings.end(), document_id,
+        [](const Posting& lhs, int rhs) { return lhs.document_id < rhs; });
+    return (it != postings.end() && it->document_id == document_id) ? it : postings.end();
+}
+
+bool SearchServer::HasPosting(const string_view word, int document_id) const {
+    const auto it = word_to_document_freqs_.find(word);
+    return it != word_to_document_freqs_.end() && FindPosting(it->second, document_id) != it->second.end();
+}
+
+bool SearchServer::HasPrefixPosting(const string_view prefix, int document_id) const {
+    bool has_posting = false;
+    ForEachPrefixWord(prefix, [&has_posting, document_id](const string_view, const PostingList& postings) {
+        has_posting = has_posting || FindPosting(postings, document_id) != postings.end();
+    });
+    return has_posting;
+}
+
+size_t SearchServer::GetPostingCount(const string_view word) const {
+    const auto it = word_to_document_freqs_.find(word);
+    return it == word_to_document_freqs_.end() ? 0 : it->second.size();
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+    using WordNode = decltype(word_to_document_freqs_)::value_type;
+    using IdNode = decltype(id_to_word_freqs_)::value_type;
     
-    const map<string_view, double>& tmp = GetWordFrequencies(document_id);
-    vector<string_view> words(tmp.size());
-    transform(execution::par,
-              tmp.begin(), tmp.end(),
-              words.begin(),
-              [](const auto& items) { return items.first;}
-              );
-    for_each(execution::par,
-             words.begin(), words.end(),
-             [this, document_id] (auto word) {
-                 word_to_document_freqs_[word].erase(document_id);
-             });
-    
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-    id_to_word_freqs_.erase(document_id);
+    MemoryStats stats;
+    for (const auto& [word, postings] : word_to_document_freqs_) {
+        stats.word_to_document_freqs.bytes += TreeNodeBytes<WordNode>() + postings.capacity() * sizeof(Posting);
+        stats.word_to_document_freqs.objects += 1 + postings.size();
+    }
+    for (const auto& [document_id, word_freqs] : id_to_word_freqs_) {
+        stats.id_to_word_freqs.bytes += TreeNodeBytes<IdNode>()
+            + word_freqs.size() * TreeNodeBytes<IdNode::second_type::value_type>();
+        stats.id_to_word_freqs.objects += 1 + word_freqs.size();
+    }
+    stats.documents.bytes = documents_.size() * TreeNodeBytes<decltype(documents_)::value_type>();
+    stats.documents.objects = documents_.size();
+    stats.document_ids.bytes = document_ids_.size() * TreeNodeBytes<int>();
+    stats.document_ids.objects = document_ids_.size();
+    stats.tombstones.bytes = pending_removals_.bucket_count() * sizeof(void*)
+        + pending_removals_.size() * HashNodeBytes<int>();
+    stats.tombstones.objects = pending_removals_.size();
+    for (const string& word : stop_words_) {
+        stats.stop_words.bytes += TreeNodeBytes<string>() + StringHeapBytes(word);
+    }
+    stats.stop_words.bytes += stop_word_filter_.GetMemoryUsage();
+    stats.stop_words.objects = stop_words_.size();
+    for (const string& word : dictionary_) {
+        stats.dictionary.bytes += TreeNodeBytes<string>() + StringHeapBytes(word);
+    }
+    stats.dictionary.objects = dictionary_.size();
+    return stats;
 }
\ No newline at end of file
@@ -7,29 +7,61 @@
 #include <map>
 #include <iostream>
 #include <set>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
 #include <execution>
 #include <string_view>
+#include <functional>
+#include <queue>
 
 #include "string_processing.h"
 #include "document.h"
 #include "log_duration.h"
 #include "concurrent_map.h"
+#include "memory_stats.h"
+#include "stop_word_filter.h"
+#include "search_budget.h"
+#include "query_profile.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double EPSILON = 1e-6;
+// Postings scored between two budget checks, also the unit of work of parallel scoring
+const size_t POSTING_BLOCK_SIZE = 1024;
+// Dictionary words a prefix query term (cat*) expands to at most, the lexicographically first ones win
+const size_t MAX_PREFIX_EXPANSIONS = 64;
+// CompactIndex erases up to this many ids from a posting list one by one, more in a single merge pass
+const size_t MAX_POINT_REMOVALS = 8;
+
+// Precision of term frequencies in the inverted index. A float keeps a posting at 8 bytes and its
+// relative error under 6e-8, so relevance stays within EPSILON of the exact value while the IDF is
+// below 16, i.e. for collections of up to ~9 million documents
+using TermFrequency = float;
+
+struct IndexOptions {
+    // Without the forward index GetWordFrequencies and RemoveDocument scan the whole inverted index
+    bool keep_forward_index = true;
+};
 
 class SearchServer {
 public:
 
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
+    explicit SearchServer(const StringContainer& stop_words, IndexOptions options = {});
 
-    explicit SearchServer(const std::string& stop_words_text);
-    explicit SearchServer(const std::string_view stop_words_text);
+    explicit SearchServer(const std::string& stop_words_text, IndexOptions options = {});
+    explicit SearchServer(const std::string_view stop_words_text, IndexOptions options = {});
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
         const std::vector<int>& ratings);
 
+    // Standing queries are checked against every added document, matches go to the handler
+    using StandingQueryHandler = std::function<void(int query_id, const Document& document)>;
+
+    int AddStandingQuery(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+    void RemoveStandingQuery(int query_id);
+    void SetStandingQueryHandler(StandingQueryHandler handler);
+
     template <typename Policy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const;
     template <typename DocumentPredicate>
@@ -43,6 +75,18 @@ public:
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, const std::string_view raw_query) const;
     std::vector<Document> FindTopDocuments(const std::execution::parallel_policy&, const std::string_view raw_query) const;
 
+    // Stops scanning postings once the budget runs out and returns the best documents found by then
+    template <typename Policy, typename DocumentPredicate>
+    SearchResult FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+        const SearchBudget& budget) const;
+    SearchResult FindTopDocuments(const std::string_view raw_query, const SearchBudget& budget) const;
+
+    // Same search, with a trace of where the time went written to the profile
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+        QueryProfile& profile) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, QueryProfile& profile) const;
+
     int GetDocumentCount() const;
 
     std::set<int>::const_iterator begin() const;
@@ -57,23 +101,82 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const std::string_view raw_query,
         int document_id) const;
 
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query,
+        int document_id, QueryProfile& profile) const;
+
+    // Parses the query once and matches it against the forward index entry of every document
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view raw_query,
+        const std::vector<int>& document_ids) const;
+
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::execution::sequenced_policy&,
+        const std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::execution::parallel_policy&,
+        const std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    // Without the forward index the result is rebuilt into a per-thread map, so the reference
+    // is only valid until the next GetWordFrequencies call on the same thread
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Returns a copy, safe to keep in either mode
+    std::map<std::string_view, double> BuildWordFrequencies(int document_id) const;
     
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy& , int document_id);
     void RemoveDocument(const std::execution::parallel_policy& , int document_id);
 
+    // Marks documents as removed right away, their postings stay in the index until CompactIndex
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    template <typename Policy>
+    void CompactIndex(const Policy& policy);
+    void CompactIndex();
+
+    MemoryStats GetMemoryStats() const;
+
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
-        std::string word;
     };
+    const IndexOptions options_;
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
+    const StopWordFilter stop_word_filter_;
+    // Owns every indexed word, the string_view keys of both indexes point here
+    std::set<std::string, std::less<>> dictionary_;
+    struct Posting {
+        int document_id;
+        TermFrequency freq;
+    };
+    // Sorted by document_id, except the lists waiting in unsorted_postings_
+    using PostingList = std::vector<Posting>;
+
+    std::map<std::string_view, PostingList> word_to_document_freqs_;
     std::map<int, std::map<std::string_view, double>> id_to_word_freqs_;
     std::map<int, DocumentData> documents_;
     std::set<int> document_ids_;
+    // Removed documents whose postings are still in the index; hashed, so ids may be sparse
+    std::unordered_set<int> pending_removals_;
+
+    bool IsRemoved(int document_id) const;
+    // Drops the postings of the given ids, sorted in ascending order
+    static void ErasePostings(PostingList& postings, const std::vector<int>& document_ids);
+    void EraseWordIfUnused(const std::string_view word);
+
+    // Postings of out-of-order ids are appended, and their lists are sorted once before the next read.
+    // Concurrent queries may all hit the same unsorted lists, hence the lock
+    mutable std::set<PostingList*> unsorted_postings_;
+    mutable std::atomic<bool> has_unsorted_postings_ = false;
+    mutable std::mutex unsorted_postings_mutex_;
+
+    void SortPendingPostings() const;
+
+    static PostingList::const_iterator FindPosting(const PostingList& postings, int document_id);
+    bool HasPosting(const std::string_view word, int document_id) const;
+    size_t GetPostingCount(const std::string_view word) const;
+    // Calls function(word, postings) for every indexed word starting with prefix
+    template <typename Function>
+    void ForEachPrefixWord(const std::string_view prefix, Function function) const;
+    bool HasPrefixPosting(const std::string_view prefix, int document_id) const;
 
     bool IsStopWord(const std::string_view word) const;
 
@@ -87,6 +190,7 @@ private:
         std::string_view data;
         bool is_minus;
         bool is_stop;
+        bool is_prefix;
     };
 
     QueryWord ParseQueryWord(const std::string_view text) const;
@@ -94,20 +198,66 @@ private:
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        std::vector<std::string_view> plus_prefixes;
+        std::vector<std::string_view> minus_prefixes;
+        // Dictionary words of every plus prefix, except the ones among plus_words or an earlier prefix's words.
+        // Minus prefixes are not expanded, exclusions walk the whole prefix range of the index instead
+        std::vector<std::vector<std::string_view>> plus_prefix_words;
     };
     
     Query ParseQuery(const std::string_view text, const bool to_sort) const;
 
+    std::vector<std::string_view> FindWordsByPrefix(const std::string_view prefix) const;
+    void ExpandPrefixes(Query& query) const;
+
+    // Plus words together with the words of plus prefixes, sorted
+    static std::vector<std::string_view> CollectPlusWords(const Query& query);
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchQuery(const Query& query, int document_id) const;
+
+    static std::vector<std::string_view> IntersectWords(const std::vector<std::string_view>& words,
+        const std::map<std::string_view, double>& word_freqs);
+    static bool HasWordWithPrefix(const std::map<std::string_view, double>& word_freqs, const std::string_view prefix);
+
+    template <typename Policy>
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchQueryBatch(const Policy& policy,
+        const std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    static void AddProfileTerms(const Query& query, QueryProfile& profile);
+
+    struct StandingQuery {
+        std::string text;
+        Query query;
+        DocumentStatus status;
+    };
+    std::map<int, StandingQuery> standing_queries_;
+    std::map<std::string, std::set<int>, std::less<>> word_to_standing_queries_;
+    int next_standing_query_id_ = 0;
+    StandingQueryHandler standing_query_handler_;
+
+    void MatchStandingQueries(int document_id, const std::map<std::string_view, double>& word_freqs) const;
+
     double ComputeWordInverseDocumentFreq(const std::string_view word) const;
 
-    template <typename Policy, typename DocumentPredicate>
+    template <typename Policy>
+    static void SelectTopDocuments(const Policy& policy, std::vector<Document>& documents);
+
+    // Walks postings in blocks of POSTING_BLOCK_SIZE, checking the budget before each block
+    template <typename Budget, typename Function>
+    static void ForEachPosting(const std::execution::sequenced_policy&, const PostingList& postings, Budget& budget, Function function);
+    template <typename Policy, typename Budget, typename Function>
+    static void ForEachPosting(const Policy& policy, const PostingList& postings, Budget& budget, Function function);
+
+    template <typename Policy, typename DocumentPredicate, typename Budget, typename Profiler>
     std::vector<Document> FindAllDocuments(const Policy& policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, Budget& budget, Profiler& profiler) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+SearchServer::SearchServer(const StringContainer& stop_words, IndexOptions options)
+    : options_(options)
+    , stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+    , stop_word_filter_(stop_words_) {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid");
     }
@@ -118,9 +268,104 @@ std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const
     DocumentPredicate document_predicate) const {
     const auto query = ParseQuery(raw_query, true);
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    UnlimitedBudget budget;
+    NoQueryProfiler profiler;
+    auto matched_documents = FindAllDocuments(policy, query, document_predicate, budget, profiler);
+    SelectTopDocuments(policy, matched_documents);
+
+    return matched_documents;
+}
+
+template <typename Policy, typename DocumentPredicate>
+SearchResult SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, const SearchBudget& budget) const {
+    auto query = ParseQuery(raw_query, true);
+    // Rare words carry the highest IDF, scanning them first makes a partial result closer to the full one
+    std::sort(query.plus_words.begin(), query.plus_words.end(),
+        [this](const std::string_view lhs, const std::string_view rhs) {
+            return GetPostingCount(lhs) < GetPostingCount(rhs);
+        });
+
+    BudgetTracker budget_tracker(budget);
+    NoQueryProfiler profiler;
+    SearchResult result;
+    result.documents = FindAllDocuments(policy, query, document_predicate, budget_tracker, profiler);
+    result.is_partial = budget_tracker.WasExhausted();
+    SelectTopDocuments(policy, result.documents);
+
+    return result;
+}
+
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, QueryProfile& profile) const {
+    using Clock = std::chrono::steady_clock;
+    profile = {};
+
+    auto start_time = Clock::now();
+    const auto query = ParseQuery(raw_query, true);
+    profile.parse_time = Clock::now() - start_time;
+
+    AddProfileTerms(query, profile);
+    UnlimitedBudget budget;
+    QueryProfiler profiler(profile);
+    start_time = Clock::now();
+    auto matched_documents = FindAllDocuments(policy, query, document_predicate, budget, profiler);
+    profile.scoring_time = Clock::now() - start_time;
+    profiler.Finish();
+    profile.matched_documents = matched_documents.size();
+
+    start_time = Clock::now();
+    SelectTopDocuments(policy, matched_documents);
+    profile.sort_time = Clock::now() - start_time;
+
+    return matched_documents;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+}
+
+template <typename Policy>
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchQueryBatch(const Policy& policy,
+    const std::string_view raw_query, const std::vector<int>& document_ids) const {
+    for (const int document_id : document_ids) {
+        if (!document_ids_.count(document_id)) {
+            using namespace std::string_literals;
+            throw std::out_of_range("out of range"s);
+        }
+    }
+    const Query query = ParseQuery(raw_query, true);
+    const std::vector<std::string_view> plus_words = CollectPlusWords(query);
+    SortPendingPostings();
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(),
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> result(document_ids.size());
+    std::transform(policy,
+            document_ids.begin(), document_ids.end(),
+            result.begin(),
+            [this, &query, &plus_words] (int document_id) -> std::tuple<std::vector<std::string_view>, DocumentStatus> {
+                if (!options_.keep_forward_index) {
+                    return MatchQuery(query, document_id);
+                }
+                // Query words and forward index keys are both sorted, so one merge pass finds the common ones
+                const auto& word_freqs = id_to_word_freqs_.at(document_id);
+                const DocumentStatus status = documents_.at(document_id).status;
+                const bool has_minus_prefixes = std::any_of(query.minus_prefixes.begin(), query.minus_prefixes.end(),
+                    [&word_freqs](const std::string_view prefix) {
+                        return HasWordWithPrefix(word_freqs, prefix);
+                    });
+                if (has_minus_prefixes || !IntersectWords(query.minus_words, word_freqs).empty()) {
+                    return { std::vector<std::string_view>{}, status };
+                }
+                return { IntersectWords(plus_words, word_freqs), status };
+            });
+    return result;
+}
+
+template <typename Policy>
+void SearchServer::SelectTopDocuments(const Policy& policy, std::vector<Document>& documents) {
+    std::sort(policy, documents.begin(), documents.end(),
         [](const Document& lhs, const Document& rhs) {
             if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
                 return lhs.rating > rhs.rating;
@@ -129,57 +374,257 @@ std::vector<Document> SearchServer::FindTopDocuments(const Policy& policy, const
                 return lhs.relevance > rhs.relevance;
             }
         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
     }
+}
 
-    return matched_documents;
+template <typename Budget, typename Function>
+void SearchServer::ForEachPosting(const std::execution::sequenced_policy&, const PostingList& postings, Budget& budget, Function function) {
+    for (size_t start = 0; start < postings.size(); start += POSTING_BLOCK_SIZE) {
+        if (budget.IsExhausted()) {
+            return;
+        }
+        const size_t end = std::min(start + POSTING_BLOCK_SIZE, postings.size());
+        for (size_t i = start; i < end; ++i) {
+            function(postings[i]);
+        }
+    }
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+template <typename Policy, typename Budget, typename Function>
+void SearchServer::ForEachPosting(const Policy& policy, const PostingList& postings, Budget& budget, Function function) {
+    // Blocks are handed out to threads by their start index
+    std::vector<size_t> block_starts;
+    for (size_t start = 0; start < postings.size(); start += POSTING_BLOCK_SIZE) {
+        block_starts.push_back(start);
+    }
+    std::for_each(policy,
+            block_starts.begin(), block_starts.end(),
+            [&postings, &budget, &function] (size_t start) {
+                if (budget.IsExhausted()) {
+                    return;
+                }
+                const size_t end = std::min(start + POSTING_BLOCK_SIZE, postings.size());
+                for (size_t i = start; i < end; ++i) {
+                    function(postings[i]);
+                }
+            });
 }
 
-template <typename Policy, typename DocumentPredicate>
+template <typename Policy, typename DocumentPredicate, typename Budget, typename Profiler>
 std::vector<Document> SearchServer::FindAllDocuments(const Policy& policy, const Query& query,
-    DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(document_ids_.size());
+    DocumentPredicate document_predicate, Budget& budget, Profiler& profiler) const {
+    SortPendingPostings();
+    
+    // Every distinct document that can gain relevance needs its own slot
+    size_t candidate_count = 0;
+    for (const std::string_view word : query.plus_words) {
+        candidate_count += GetPostingCount(word);
+    }
+    for (const auto& words : query.plus_prefix_words) {
+        for (const std::string_view word : words) {
+            candidate_count += GetPostingCount(word);
+        }
+    }
+    const size_t capacity = std::min(candidate_count, documents_.size() + pending_removals_.size());
+    ConcurrentAccumulator<int, double> document_to_relevance(capacity);
+    profiler.OnAccumulator(capacity);
     
     std::for_each(policy, 
             query.plus_words.begin(), query.plus_words.end(),
-            [this, &document_to_relevance, &document_predicate, &policy] (const std::string_view word) {
-               if (word_to_document_freqs_.count(word) > 0) {
-                   const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                   for_each(policy,
-                           word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                           [this, &document_to_relevance, &document_predicate, &inverse_document_freq] (const auto& document) {
-                               const auto& document_data = documents_.at(document.first);
-                               if (document_predicate(document.first, document_data.status, document_data.rating)) {
-                                   document_to_relevance[document.first].ref_to_value += document.second * inverse_document_freq;
-                               }
-                           });
-               } 
+            [this, &query, &document_to_relevance, &document_predicate, &policy, &budget, &profiler] (const std::string_view& word) {
+               const auto it = word_to_document_freqs_.find(word);
+               if (it == word_to_document_freqs_.end()) {
+                   return;
+               }
+               const size_t term_index = &word - query.plus_words.data();
+               const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+               profiler.OnTerm(term_index, it->second.size(), inverse_document_freq);
+               ForEachPosting(policy, it->second, budget,
+                       [this, &document_to_relevance, &document_predicate, &profiler, inverse_document_freq, term_index] (const Posting& posting) {
+                           if (IsRemoved(posting.document_id)) {
+                               profiler.OnPosting(term_index, false);
+                               return;
+                           }
+                           const auto& document_data = documents_.at(posting.document_id);
+                           const bool is_accepted = document_predicate(posting.document_id, document_data.status, document_data.rating);
+                           if (is_accepted) {
+                               document_to_relevance.Add(posting.document_id, posting.freq * inverse_document_freq);
+                           }
+                           profiler.OnPosting(term_index, is_accepted);
+                       });
+            });
+    
+    std::for_each(policy,
+            query.plus_prefix_words.begin(), query.plus_prefix_words.end(),
+            [this, &query, &document_to_relevance, &document_predicate, &budget, &profiler] (const std::vector<std::string_view>& words) {
+                const size_t term_index = query.plus_words.size() + query.minus_words.size() + (&words - query.plus_prefix_words.data());
+                struct Cursor {
+                    const PostingList* postings;
+                    size_t position;
+                    double inverse_document_freq;
+                    int GetDocumentId() const {
+                        return (*postings)[position].document_id;
+                    }
+                };
+                const auto is_later = [](const Cursor& lhs, const Cursor& rhs) {
+                    return lhs.GetDocumentId() > rhs.GetDocumentId();
+                };
+                std::priority_queue<Cursor, std::vector<Cursor>, decltype(is_later)> cursors(is_later);
+                size_t posting_count = 0;
+                double inverse_document_freq_sum = 0.0;
+                for (const std::string_view word : words) {
+                    const PostingList& postings = word_to_document_freqs_.at(word);
+                    const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+                    posting_count += postings.size();
+                    inverse_document_freq_sum += inverse_document_freq;
+                    cursors.push({ &postings, 0, inverse_document_freq });
+                }
+                profiler.OnTerm(term_index, posting_count, inverse_document_freq_sum);
+                
+                // Merges the posting lists of all expansions by document id, so every document
+                // gets the relevance of the whole prefix in one accumulator update
+                for (size_t merged = 0; !cursors.empty(); ++merged) {
+                    if (merged % POSTING_BLOCK_SIZE == 0 && budget.IsExhausted()) {
+                        return;
+                    }
+                    const int document_id = cursors.top().GetDocumentId();
+                    double relevance = 0.0;
+                    while (!cursors.empty() && cursors.top().GetDocumentId() == document_id) {
+                        Cursor cursor = cursors.top();
+                        cursors.pop();
+                        relevance += (*cursor.postings)[cursor.position].freq * cursor.inverse_document_freq;
+                        if (++cursor.position < cursor.postings->size()) {
+                            cursors.push(cursor);
+                        }
+                    }
+                    if (IsRemoved(document_id)) {
+                        profiler.OnPosting(term_index, false);
+                        continue;
+                    }
+                    const auto& document_data = documents_.at(document_id);
+                    const bool is_accepted = document_predicate(document_id, document_data.status, document_data.rating);
+                    if (is_accepted) {
+                        document_to_relevance.Add(document_id, relevance);
+                    }
+                    profiler.OnPosting(term_index, is_accepted);
+                }
             });
+    profiler.OnPlusTermsScored(document_to_relevance);
     
     std::for_each(policy,
             query.minus_words.begin(), query.minus_words.end(),
-            [this, &document_to_relevance, &policy] (const std::string_view word) {
-                if (word_to_document_freqs_.count(word) > 0) {
-                    std::for_each(policy,
-                                 word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                                 [this, &document_to_relevance] (const auto& document) {
-                                     document_to_relevance.Erase(document.first);
-                                 });
+            [this, &query, &document_to_relevance, &policy, &budget, &profiler] (const std::string_view& word) {
+                const auto it = word_to_document_freqs_.find(word);
+                if (it == word_to_document_freqs_.end()) {
+                    return;
                 }
+                const size_t term_index = query.plus_words.size() + (&word - query.minus_words.data());
+                profiler.OnTerm(term_index, it->second.size(), 0.0);
+                ForEachPosting(policy, it->second, budget,
+                        [&document_to_relevance, &profiler, term_index] (const Posting& posting) {
+                            profiler.OnPosting(term_index, document_to_relevance.Erase(posting.document_id));
+                        });
             });
-
-    const std::map<int, double> ordinary_map = document_to_relevance.BuildOrdinaryMap();
     
+    // Unlike plus prefixes, exclusions are not capped: every word of the prefix range is applied
+    std::for_each(policy,
+            query.minus_prefixes.begin(), query.minus_prefixes.end(),
+            [this, &query, &document_to_relevance, &policy, &budget, &profiler] (const std::string_view& prefix) {
+                const size_t term_index = query.plus_words.size() + query.minus_words.size() + query.plus_prefixes.size()
+                    + (&prefix - query.minus_prefixes.data());
+                size_t posting_count = 0;
+                ForEachPrefixWord(prefix,
+                        [&document_to_relevance, &policy, &budget, &profiler, &posting_count, term_index] (const std::string_view, const PostingList& postings) {
+                            posting_count += postings.size();
+                            ForEachPosting(policy, postings, budget,
+                                    [&document_to_relevance, &profiler, term_index] (const Posting& posting) {
+                                        profiler.OnPosting(term_index, document_to_relevance.Erase(posting.document_id));
+                                    });
+                        });
+                profiler.OnTerm(term_index, posting_count, 0.0);
+            });
+
     std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : ordinary_map) {
+    for (const auto& [document_id, relevance] : document_to_relevance.BuildUnorderedVector()) {
         matched_documents.push_back(
             { document_id, relevance, documents_.at(document_id).rating });
     }
+    if (budget.WasExhausted()) {
+        // Minus words may have been skipped, the found documents are few enough to check one by one
+        matched_documents.erase(std::remove_if(matched_documents.begin(), matched_documents.end(),
+                                               [this, &query](const Document& document) {
+                                                   return std::any_of(query.minus_words.begin(), query.minus_words.end(),
+                                                       [this, &document](const std::string_view word) {
+                                                           return HasPosting(word, document.id);
+                                                       })
+                                                       || std::any_of(query.minus_prefixes.begin(), query.minus_prefixes.end(),
+                                                       [this, &document](const std::string_view prefix) {
+                                                           return HasPrefixPosting(prefix, document.id);
+                                                       });
+                                               }),
+                                matched_documents.end());
+    }
     return matched_documents;
+}
+
+template <typename Function>
+void SearchServer::ForEachPrefixWord(const std::string_view prefix, Function function) const {
+    for (auto it = word_to_document_freqs_.lower_bound(prefix);
+         it != word_to_document_freqs_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        function(it->first, it->second);
+    }
+}
+
+template <typename Policy>
+void SearchServer::CompactIndex(const Policy& policy) {
+    if (pending_removals_.empty()) {
+        return;
+    }
+    // Compaction may erase posting lists, none of them must stay in unsorted_postings_
+    SortPendingPostings();
+    
+    std::vector<int> removed_ids(pending_removals_.begin(), pending_removals_.end());
+    std::sort(removed_ids.begin(), removed_ids.end());
+    
+    // Every posting list is a separate vector, so they can be rewritten concurrently
+    if (options_.keep_forward_index) {
+        // Only the words of removed documents are touched, each with the ids it loses, in ascending order
+        std::map<std::string_view, std::vector<int>> word_to_removed_ids;
+        for (const int document_id : removed_ids) {
+            for (const auto& [word, freq] : id_to_word_freqs_.at(document_id)) {
+                word_to_removed_ids[word].push_back(document_id);
+            }
+            id_to_word_freqs_.erase(document_id);
+        }
+        std::for_each(policy,
+                word_to_removed_ids.begin(), word_to_removed_ids.end(),
+                [this] (const std::pair<const std::string_view, std::vector<int>>& entry) {
+                    ErasePostings(word_to_document_freqs_.at(entry.first), entry.second);
+                });
+        for (const auto& [word, ids] : word_to_removed_ids) {
+            EraseWordIfUnused(word);
+        }
+    }
+    else {
+        std::for_each(policy,
+                word_to_document_freqs_.begin(), word_to_document_freqs_.end(),
+                [&removed_ids] (std::pair<const std::string_view, PostingList>& entry) {
+                    ErasePostings(entry.second, removed_ids);
+                });
+        for (auto it = word_to_document_freqs_.begin(); it != word_to_document_freqs_.end();) {
+            if (it->second.empty()) {
+                const auto word_it = dictionary_.find(it->first);
+                it = word_to_document_freqs_.erase(it);
+                dictionary_.erase(word_it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    
+    // Swapped rather than cleared, which would keep the bucket array of a large batch
+    std::unordered_set<int>().swap(pending_removals_);
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <cstring>
+
+#include "stop_word_filter.h"
+
+using namespace std;
+
+StopWordFilter::StopWordFilter(const set<string, less<>>& stop_words) {
+    if (stop_words.empty()) {
+        return;
+    }
+    size_t slot_count = 1;
+    while (slot_count < 2 * stop_words.size()) {
+        slot_count <<= 1;
+    }
+    slots_.resize(slot_count);
+    mask_ = slot_count - 1;
+    
+    for (const string& word : stop_words) {
+        const uint64_t hash = Hash(word);
+        size_t index = hash & mask_;
+        while (slots_[index].fingerprint != 0) {
+            index = (index + 1) & mask_;
+        }
+        slots_[index] = { Fingerprint(hash), static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(word.size()) };
+        chars_ += word;
+        max_length_ = max(max_length_, word.size());
+    }
+}
+
+bool StopWordFilter::Contains(const string_view word) const {
+    if (word.size() > max_length_ || slots_.empty()) {
+        return false;
+    }
+    const uint64_t hash = Hash(word);
+    const uint32_t fingerprint = Fingerprint(hash);
+    for (size_t index = hash & mask_; slots_[index].fingerprint != 0; index = (index + 1) & mask_) {
+        const Slot& slot = slots_[index];
+        if (slot.fingerprint == fingerprint && slot.length == word.size()
+            && memcmp(chars_.data() + slot.offset, word.data(), word.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t StopWordFilter::GetMemoryUsage() const {
+    return chars_.capacity() + slots_.capacity() * sizeof(Slot);
+}
+
+uint64_t StopWordFilter::Hash(const string_view word) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint32_t StopWordFilter::Fingerprint(uint64_t hash) {
+    // Zero marks an empty slot
+    return static_cast<uint32_t>(hash >> 32) | 1u;
+}
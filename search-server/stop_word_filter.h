@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Open-addressing hash set of stop words, built once and only read afterwards.
+// Slots keep a hash fingerprint, so a lookup rarely compares characters of a non-stop word
+class StopWordFilter {
+public:
+    explicit StopWordFilter(const std::set<std::string, std::less<>>& stop_words);
+
+    bool Contains(const std::string_view word) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Slot {
+        uint32_t fingerprint = 0;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    std::string chars_;
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    size_t max_length_ = 0;
+
+    static uint64_t Hash(const std::string_view word);
+    static uint32_t Fingerprint(uint64_t hash);
+};